@@ -1,7 +1,9 @@
 #!/bin/bash python
 import subprocess
+import io
 import numpy as np
 from matplotlib import pyplot as plt
+import csv
 
 vis = "false"
 
@@ -20,51 +22,43 @@ for det in detectors:
             p = subprocess.Popen("./2D_feature_tracking {} {} {}".format(vis, det, desc), cwd="./build", shell=True, stdout=subprocess.PIPE, stderr=subprocess.PIPE, universal_newlines=True)
             out, err = p.communicate()
             if p.returncode == 0:
-                out = out.split("\n")
-                for line in out:
-                    if line.startswith("Detector"):
-                        results.append(line)
+                # The program writes one CSV row per image.
+                results.extend(csv.DictReader(io.StringIO(out)))
             else:
-                results.append("Invalid combination|{}|{}".format(det, desc))
+                results.append({"invalid": True, "detector": det, "descriptor": desc})
         except Exception as e:
             pass
         print(".", end="", flush=True)
 
 print("Results:")
-for line in results:
-    print(line)
+for row in results:
+    print(row)
 
 print("\nProcessing data:")
 
 detector_results = {}
 
-for line in results:
+for row in results:
     # Discard invalid combinations.
-    if line.startswith("Invalid"):
-        combination = line.split("|")
-        print("Detector {} and descriptor {} form an invalid combination. Discarding results".format(combination[1], combination[2]))
+    if "invalid" in row:
+        print("Detector {} and descriptor {} form an invalid combination. Discarding results".format(row["detector"], row["descriptor"]))
         continue
 
-    # Join detectors.
-    combination_results = line.split("|")
-    print(combination_results)
-    
-    # First element is the detector.
-    detector = combination_results[0].split(":")[1]
-    # Second element is the descriptor.
-    descriptor = combination_results[1].split(":")[1]
-    # Third element is the matcher.
-    matcher = combination_results[2].split(":")[1]
-    # Fourth element is the number of points total.
-    pts_total = combination_results[3].split(":")[1]
-    # Fifth element is the number of points on the vehicle in front.
-    pts_vehicle = combination_results[4].split(":")[1]
-    # Sixth element is the number of matches.
-    matches = combination_results[5].split(":")[1]
-    # Seventh element is the time for detector.
-    detector_time = combination_results[6].split(":")[1]
-    # Eighth element is the time for descriptor.
-    descriptor_time = combination_results[7].split(":")[1]
+    print(row)
+
+    detector = row["detector"]
+    descriptor = row["descriptor"]
+    matcher = row["matcher"]
+    # Number of points total.
+    pts_total = row["pts_total"]
+    # Number of points on the vehicle in front.
+    pts_vehicle = row["pts_vehicle"]
+    # Number of matches.
+    matches = row["matches"]
+    # Time for detector.
+    detector_time = row["time_detector_ms"]
+    # Time for descriptor.
+    descriptor_time = row["time_descriptor_ms"]
 
     # Join them together.
     if detector not in detector_results:
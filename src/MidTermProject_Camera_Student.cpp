@@ -1,4 +1,5 @@
 /* INCLUDES FOR THIS PROJECT */
+#include <algorithm>
 #include <iostream>
 #include <fstream>
 #include <sstream>
@@ -6,6 +7,7 @@
 #include <vector>
 #include <cmath>
 #include <limits>
+#include <stdexcept>
 #include <opencv2/core.hpp>
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
@@ -15,8 +17,12 @@
 
 #include "dataStructures.h"
 #include "matching2D.hpp"
+#include "resultWriter.hpp"
+#include "verification2D.hpp"
 
 #include <deque>
+#include <unordered_map>
+#include <unordered_set>
 
 using namespace std;
 
@@ -28,6 +34,10 @@ int main(int argc, const char *argv[])
     string descriptorType = "BRIEF"; // BRISK; BRIEF, ORB, FREAK, AKAZE, SIFT
     string matcherType = "MAT_BF";        // MAT_BF, MAT_FLANN
     string selectorType = "SEL_NN";       // SEL_NN, SEL_KNN
+    string outputFormat = "OUT_CSV";      // OUT_CSV, OUT_JSONL
+    string verifierType = "VER_NONE";     // VER_NONE, VER_HOMOGRAPHY, VER_FUNDAMENTAL
+    string storageType = "STORE_FULL";    // STORE_FULL, STORE_LEAN
+    size_t dataBufferSize = 2;            // no. of images which are held in memory (ring buffer) at the same time
     bool bVis = true;            // visualize results
 
     // Try to read the descriptor/detector type from the command line.
@@ -62,14 +72,60 @@ int main(int argc, const char *argv[])
         selectorType = argv[5];
     }
 
-     // Display used paramters.
-    std::cout << "Using detector: " << detectorType << std::endl;
-    std::cout << "Using descriptor: " << descriptorType << std::endl;
-    std::cout << "Using matcher: " << matcherType << std::endl;
-    std::cout << "Using selector: " << selectorType << std::endl;
+    // Output format.
+    if (argc > 6)
+    {
+        outputFormat = argv[6];
+    }
+
+    // Verifier type.
+    if (argc > 7)
+    {
+        verifierType = argv[7];
+    }
+
+    // Storage type.
+    if (argc > 8)
+    {
+        storageType = argv[8];
+    }
+
+    // Buffer size.
+    if (argc > 9)
+    {
+        const int size = std::stoi(argv[9]);
+
+        if (size < 2)
+        {
+            throw std::runtime_error("Buffer size must be at least 2.");
+        }
+        dataBufferSize = static_cast<size_t>(size);
+    }
+
+    if (storageType != "STORE_FULL" && storageType != "STORE_LEAN")
+    {
+        throw std::runtime_error("Storage " + storageType + " not known to this program.");
+    }
+    const bool bLeanStorage = storageType == "STORE_LEAN";
+
+    // Lean storage drops the images and the full keypoints, which the visualization needs.
+    if (bLeanStorage && bVis)
+    {
+        throw std::runtime_error("Storage STORE_LEAN can not be used together with visualization.");
+    }
 
     string descriptorTypeCat = descriptorType.compare("SIFT") == 0 ? "DES_HOG" : "DES_BINARY"; // DES_BINARY, DES_HOG
-    std::cout << "Using descriptor type: " << descriptorTypeCat << std::endl;
+
+    // Display used paramters. Goes to stderr so stdout only carries the results.
+    std::cerr << "Using detector: " << detectorType << "\n"
+              << "Using descriptor: " << descriptorType << "\n"
+              << "Using matcher: " << matcherType << "\n"
+              << "Using selector: " << selectorType << "\n"
+              << "Using descriptor type: " << descriptorTypeCat << "\n"
+              << "Using verifier: " << verifierType << "\n"
+              << "Using storage: " << storageType << "\n"
+              << "Using buffer size: " << dataBufferSize << "\n"
+              << "Using output format: " << outputFormat << "\n";
 
 
     /* INIT VARIABLES AND DATA STRUCTURES */
@@ -85,8 +141,20 @@ int main(int argc, const char *argv[])
     int imgEndIndex = 9;   // last file index to load
     int imgFillWidth = 4;  // no. of digits which make up the file index (e.g. img-0001.png)
     // misc
-    constexpr int dataBufferSize = 2;       // no. of images which are held in memory (ring buffer) at the same time
     std::deque<DataFrame> dataBuffer; // Use deque for FIFO ring buffer.
+    ResultWriter resultWriter(outputFormat); // Buffers the per-frame results until the end of the run.
+
+    // The current image is matched against all previous images in the buffer (targets), newest first.
+    const size_t maxTargets = dataBufferSize - 1;
+    std::vector<GeometricVerifier> verifiers(maxTargets, GeometricVerifier(verifierType)); // One per target, keep their working buffers between frames.
+    std::vector<cv::Mat> descTargets; // Descriptors of the targets (headers only, the data is shared with the buffer).
+    std::vector<std::vector<cv::DMatch>> targetMatches; // Matches for each target.
+    descTargets.reserve(maxTargets);
+
+    // Tracks.
+    int nextTrackId = 0;
+    std::unordered_set<int> claimedTracks; // Tracks already continued by a keypoint of the current image.
+    std::unordered_map<int, std::pair<int, size_t>> newestObservations; // Track id -> length and target index of its newest observation.
 
     /* MAIN LOOP OVER ALL IMAGES */
 
@@ -94,6 +162,17 @@ int main(int argc, const char *argv[])
     {
         size_t pts_total = 0;
         size_t pts_on_vehicle = 0;
+        double matcher_time = 0.0;
+        double verification_time = 0.0;
+        size_t matches_raw = 0;
+        size_t matches_raw_all = 0;
+        size_t matches_all = 0;
+        size_t matching_cache_lines_modeled = 0;
+        size_t n_targets = 0;
+        size_t tracks_continued = 0;
+        size_t tracks_recovered = 0;
+        double track_length_mean = 0.0;
+        int track_length_max = 0;
 
         /* LOAD IMAGE INTO BUFFER */
 
@@ -221,8 +300,18 @@ int main(int argc, const char *argv[])
         // Descriptor time.
         // const double descriptor_time = (static_cast<double>(cv::getTickCount()) - descriptor_start) / cv::getTickFrequency() * 1000.0 / 1.0;
 
-        // push descriptors for current frame to end of data buffer
-        (dataBuffer.end() - 1)->descriptors = descriptors;
+        // push descriptors for current frame to end of data buffer, the matchers expect one contiguous block
+        // (cv::Mat allocations are already aligned for SIMD access)
+        (dataBuffer.end() - 1)->descriptors = descriptors.isContinuous() ? descriptors : descriptors.clone();
+
+        // In lean storage mode only what matching needs is kept: the descriptors and the keypoint positions.
+        if (bLeanStorage)
+        {
+            DataFrame &current = *(dataBuffer.end() - 1);
+            current.kptPoints.assign(current.keypoints);
+            std::vector<cv::KeyPoint>().swap(current.keypoints);
+            current.cameraImg.release();
+        }
 
 
         // std::cout << detectorType << " detector took " << detector_time << " ms." << std::endl;
@@ -234,30 +323,92 @@ int main(int argc, const char *argv[])
 
         // std::cout << "#3 : EXTRACT DESCRIPTORS done" << std::endl;
 
+        n_targets = dataBuffer.size() - 1;
+
         if (dataBuffer.size() > 1) // wait until at least two images have been processed
         {
 
             /* MATCH KEYPOINT DESCRIPTORS */
-            vector<cv::DMatch> matches;
+            const DataFrame &current = *(dataBuffer.end() - 1);
+
+            descTargets.clear();
+            for (size_t t = 0; t < n_targets; ++t)
+            {
+                descTargets.push_back((dataBuffer.end() - 2 - t)->descriptors);
+            }
 
             //// STUDENT ASSIGNMENT
             //// TASK MP.5 -> add FLANN matching in file matching2D.cpp
             //// TASK MP.6 -> add KNN match selection and perform descriptor distance ratio filtering with t=0.8 in file matching2D.cpp
-            matchDescriptors(
-                (dataBuffer.end() - 2)->keypoints, 
-                (dataBuffer.end() - 1)->keypoints,
-                (dataBuffer.end() - 2)->descriptors,
-                (dataBuffer.end() - 1)->descriptors,
-                matches, 
+            const double matcher_start = static_cast<double>(cv::getTickCount());
+
+            matchDescriptorsBatch(
+                current.descriptors,
+                descTargets,
+                targetMatches,
                 descriptorTypeCat, 
                 matcherType, 
                 selectorType
             );
 
+            matcher_time = (static_cast<double>(cv::getTickCount()) - matcher_start) / cv::getTickFrequency() * 1000.0;
+
             //// EOF STUDENT ASSIGNMENT
 
-            // store matches in current data frame
-            (dataBuffer.end() - 1)->kptMatches = matches;
+            /* VERIFY KEYPOINT MATCHES */
+
+            // Only keep the matches consistent with the geometry between the current image and each target.
+            matches_raw = targetMatches[0].size();
+
+            for (size_t t = 0; t < n_targets; ++t)
+            {
+                matches_raw_all += targetMatches[t].size();
+            }
+
+            // Modeled cache lines read per target: the descriptors of both images, and one gather per matched keypoint
+            // in each image during verification (no reuse of lines between gathers is assumed).
+            for (size_t t = 0; t < n_targets; ++t)
+            {
+                const DataFrame &target = *(dataBuffer.end() - 2 - t);
+                matching_cache_lines_modeled += current.descriptorCacheLines() + target.descriptorCacheLines();
+
+                if (verifierType != "VER_NONE")
+                {
+                    for (const auto &match : targetMatches[t])
+                    {
+                        matching_cache_lines_modeled += target.pointCacheLines(match.queryIdx) + current.pointCacheLines(match.trainIdx);
+                    }
+                }
+            }
+
+            const double verification_start = static_cast<double>(cv::getTickCount());
+
+            cv::parallel_for_(cv::Range(0, static_cast<int>(n_targets)), [&](const cv::Range &range) {
+                for (int t = range.start; t < range.end; ++t)
+                {
+                    const DataFrame &target = *(dataBuffer.end() - 2 - t);
+
+                    if (bLeanStorage)
+                    {
+                        verifiers[t].verify(target.kptPoints, current.kptPoints, targetMatches[t]);
+                    }
+                    else
+                    {
+                        verifiers[t].verify(target.keypoints, current.keypoints, targetMatches[t]);
+                    }
+                }
+            });
+
+            verification_time = (static_cast<double>(cv::getTickCount()) - verification_start) / cv::getTickFrequency() * 1000.0;
+
+            for (size_t t = 0; t < n_targets; ++t)
+            {
+                matches_all += targetMatches[t].size();
+            }
+
+            // store matches between previous and current image in current data frame
+            (dataBuffer.end() - 1)->kptMatches = targetMatches[0];
+            const vector<cv::DMatch> &matches = (dataBuffer.end() - 1)->kptMatches;
 
             // std::cout << "#4 : MATCH KEYPOINT DESCRIPTORS done" << std::endl;
 
@@ -276,7 +427,7 @@ int main(int argc, const char *argv[])
                 string windowName = "Matching keypoints between two camera images";
                 cv::namedWindow(windowName, 7);
                 cv::imshow(windowName, matchImg);
-                std::cout << "Press key to continue to next image" << std::endl;
+                std::cerr << "Press key to continue to next image" << std::endl;
                 
                 // Only if visualization is on wait for key.
                 if (bVis)
@@ -286,18 +437,112 @@ int main(int argc, const char *argv[])
             }
         }
 
-        // Output the results.
-        std::cout << "Detector:" << detectorType 
-                    << "|Descriptor:" << descriptorType 
-                    << "|Matcher:" << matcherType 
-                    << "|Total:" << pts_total 
-                    << "|Vehicle:" << pts_on_vehicle 
-                    << "|Matches:" << (dataBuffer.end() - 1)->kptMatches.size() 
-                    << "|Time Detector[ms]:" << detector_time
-                    << "|Time Descriptor[ms]:" << descriptor_time
-                    << std::endl;
+        /* TRACK KEYPOINTS */
+
+        // A keypoint continues the track of the keypoint it is matched to, matches to newer images take precedence.
+        // Matches to older images recover the tracks of keypoints which have not been matched in between.
+        {
+            DataFrame &current = *(dataBuffer.end() - 1);
+            const size_t n_kpts = static_cast<size_t>(current.descriptors.rows);
+
+            current.trackIds.assign(n_kpts, -1);
+            current.trackLengths.assign(n_kpts, 1);
+            claimedTracks.clear();
+
+            // Targets are ordered newest first, so the first observation of a track is its newest one.
+            newestObservations.clear();
+            for (size_t t = 0; t < n_targets; ++t)
+            {
+                const DataFrame &target = *(dataBuffer.end() - 2 - t);
+
+                for (size_t i = 0; i < target.trackIds.size(); ++i)
+                {
+                    newestObservations.emplace(target.trackIds[i], std::make_pair(target.trackLengths[i], t));
+                }
+            }
+
+            for (size_t t = 0; t < n_targets; ++t)
+            {
+                const DataFrame &target = *(dataBuffer.end() - 2 - t);
+
+                for (const auto &match : targetMatches[t])
+                {
+                    const int track_id = target.trackIds[match.queryIdx];
+
+                    // Each keypoint belongs to one track and each track has at most one keypoint per image.
+                    if (current.trackIds[match.trainIdx] != -1 || !claimedTracks.insert(track_id).second)
+                    {
+                        continue;
+                    }
+
+                    // The length continues from the newest observation, even if the match was found in an older image.
+                    const std::pair<int, size_t> &newest = newestObservations.at(track_id);
+
+                    current.trackIds[match.trainIdx] = track_id;
+                    current.trackLengths[match.trainIdx] = newest.first + 1;
+
+                    ++tracks_continued;
+
+                    // Only tracks which are missing in the previous image have been recovered.
+                    if (newest.second > 0)
+                    {
+                        ++tracks_recovered;
+                    }
+                }
+            }
+
+            // Start new tracks for the unmatched keypoints.
+            for (size_t i = 0; i < n_kpts; ++i)
+            {
+                if (current.trackIds[i] == -1)
+                {
+                    current.trackIds[i] = nextTrackId++;
+                }
+
+                track_length_mean += current.trackLengths[i];
+                track_length_max = std::max(track_length_max, current.trackLengths[i]);
+            }
+
+            if (n_kpts > 0)
+            {
+                track_length_mean /= n_kpts;
+            }
+        }
+
+        // Store the results, they are written out once all images are processed.
+        FrameResult result;
+        result.image = static_cast<int>(imgStartIndex + imgIndex);
+        result.detector = detectorType;
+        result.descriptor = descriptorType;
+        result.matcher = matcherType;
+        result.selector = selectorType;
+        result.ptsTotal = pts_total;
+        result.ptsVehicle = pts_on_vehicle;
+        result.matchesRaw = matches_raw;
+        result.matches = (dataBuffer.end() - 1)->kptMatches.size();
+        result.matchesRawAll = matches_raw_all;
+        result.matchesAll = matches_all;
+        result.timeDetector = detector_time;
+        result.timeDescriptor = descriptor_time;
+        result.timeMatcher = matcher_time;
+        result.timeVerification = verification_time;
+        result.frameBytes = (dataBuffer.end() - 1)->memoryBytes();
+        for (const auto &buffered : dataBuffer)
+        {
+            result.bufferBytes += buffered.memoryBytes();
+        }
+        result.matchingCacheLinesModeled = matching_cache_lines_modeled;
+        result.targets = n_targets;
+        result.tracksContinued = tracks_continued;
+        result.tracksRecovered = tracks_recovered;
+        result.trackLengthMean = track_length_mean;
+        result.trackLengthMax = track_length_max;
+        resultWriter.add(result);
 
     } // eof loop over all images
 
+    // Output the results.
+    resultWriter.write(std::cout);
+
     return 0;
 }
@@ -2,16 +2,110 @@
 #define dataStructures_h
 
 #include <vector>
+#include <string>
 #include <opencv2/core.hpp>
 
 
+struct KeyPointsSoA { // keypoint positions in structure-of-arrays layout, without the fields matching does not use
+
+    std::vector<float> x; // x coordinates
+    std::vector<float> y; // y coordinates
+
+    void assign(const std::vector<cv::KeyPoint> &keypoints)
+    {
+        x.resize(keypoints.size());
+        y.resize(keypoints.size());
+
+        for (size_t i = 0; i < keypoints.size(); ++i)
+        {
+            x[i] = keypoints[i].pt.x;
+            y[i] = keypoints[i].pt.y;
+        }
+    }
+
+    size_t size() const { return x.size(); }
+};
+
 struct DataFrame { // represents the available sensor information at the same time instance
     
     cv::Mat cameraImg; // camera image
     
     std::vector<cv::KeyPoint> keypoints; // 2D keypoints within camera image
-    cv::Mat descriptors; // keypoint descriptors
+    KeyPointsSoA kptPoints; // keypoint positions, replaces keypoints in lean storage mode
+    cv::Mat descriptors; // keypoint descriptors (one contiguous block)
     std::vector<cv::DMatch> kptMatches; // keypoint matches between previous and current frame
+    std::vector<int> trackIds; // persistent track id of each keypoint
+    std::vector<int> trackLengths; // no. of frames the track of each keypoint has been observed in
+
+    // Bytes held by the frame.
+    size_t memoryBytes() const
+    {
+        return cameraImg.total() * cameraImg.elemSize()
+            + keypoints.capacity() * sizeof(cv::KeyPoint)
+            + (kptPoints.x.capacity() + kptPoints.y.capacity()) * sizeof(float)
+            + descriptors.total() * descriptors.elemSize()
+            + kptMatches.capacity() * sizeof(cv::DMatch)
+            + (trackIds.capacity() + trackLengths.capacity()) * sizeof(int);
+    }
+
+    // Bytes of descriptor data, all of it is read when the frame is matched.
+    size_t descriptorBytes() const
+    {
+        return descriptors.total() * descriptors.elemSize();
+    }
+
+    // Cache lines (64 bytes, storage assumed line aligned) read sequentially when the descriptors are matched.
+    size_t descriptorCacheLines() const
+    {
+        return (descriptorBytes() + 63) / 64;
+    }
+
+    // Cache lines read to gather the position of keypoint i during verification.
+    size_t pointCacheLines(int i) const
+    {
+        if (!keypoints.empty())
+        {
+            // pt is the first member of the 28 byte cv::KeyPoint, it touches two lines when it crosses a line boundary.
+            const size_t begin = static_cast<size_t>(i) * sizeof(cv::KeyPoint);
+            const size_t end = begin + sizeof(cv::Point2f) - 1;
+            return end / 64 - begin / 64 + 1;
+        }
+
+        // x and y live in separate arrays, a random gather touches one line in each.
+        return 2;
+    }
+};
+
+struct FrameResult { // measurements collected for a single processed image
+
+    int image = 0; // index of the image in the sequence
+
+    std::string detector; // detector type
+    std::string descriptor; // descriptor type
+    std::string matcher; // matcher type
+    std::string selector; // selector type
+
+    size_t ptsTotal = 0; // keypoints detected in the whole image
+    size_t ptsVehicle = 0; // keypoints detected on the preceding vehicle
+    size_t matchesRaw = 0; // keypoint matches before geometric verification
+    size_t matches = 0; // keypoint matches between previous and current frame
+    size_t matchesRawAll = 0; // keypoint matches before geometric verification, summed over all previous frames in the buffer
+    size_t matchesAll = 0; // keypoint matches, summed over all previous frames in the buffer
+
+    double timeDetector = 0.0; // detector time [ms]
+    double timeDescriptor = 0.0; // descriptor time [ms]
+    double timeMatcher = 0.0; // matcher time [ms]
+    double timeVerification = 0.0; // geometric verification time [ms]
+
+    size_t frameBytes = 0; // bytes held by the current frame
+    size_t bufferBytes = 0; // bytes held by all frames in the buffer
+    size_t matchingCacheLinesModeled = 0; // modeled cache lines read by matching and verification (descriptors and matched positions)
+
+    size_t targets = 0; // no. of previous frames the current frame has been matched against
+    size_t tracksContinued = 0; // keypoints which continue an existing track
+    size_t tracksRecovered = 0; // keypoints which continue a track not matched in the previous frame
+    double trackLengthMean = 0.0; // mean no. of frames the tracks of the current keypoints have been observed in
+    int trackLengthMax = 0; // maximum no. of frames a track of the current keypoints has been observed in
 };
 
 
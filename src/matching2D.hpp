@@ -25,5 +25,7 @@ void detKeypointsModern(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img, std:
 void descKeypoints(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img, cv::Mat &descriptors, std::string descriptorType, double& time);
 void matchDescriptors(std::vector<cv::KeyPoint> &kPtsSource, std::vector<cv::KeyPoint> &kPtsRef, cv::Mat &descSource, cv::Mat &descRef,
                       std::vector<cv::DMatch> &matches, std::string descriptorType, std::string matcherType, std::string selectorType);
+void matchDescriptorsBatch(const cv::Mat &descCurrent, const std::vector<cv::Mat> &descTargets, std::vector<std::vector<cv::DMatch>> &matches,
+                           std::string descriptorType, std::string matcherType, std::string selectorType);
 
 #endif /* matching2D_hpp */
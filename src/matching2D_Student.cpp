@@ -5,30 +5,18 @@
 using namespace std;
 
 /**
- * Find the match for keypoints in two camera images using the descriptors.
+ * Create the matcher for the descriptor category.
  * 
- * @param kPtsSource <std::vector<cv::KeyPoint>> Source keypoints.
- * @param kPtsRef <std::vector<cv::KeyPoint>> Reference keypoints.
- * @param descSource <cv::Mat> Descriptor source.
- * @param descRef <cv::Mat> Descriptor reference.
- * @param matches <std::vector<cv::DMatch>> Matches.
  * @param descriptorTypeCategory <std::string> Category of the descriptor (either DES_HOG or DES_BINARY).
  * @param matcherType <std::string> Type of the matcher (MAT_BF or MAT_FLANN).
  * @param selectorType <std::string> Type of the selector (SEL_NN or SEL_KNN).
+ * @return <cv::Ptr<cv::DescriptorMatcher>> Matcher.
  */
-void matchDescriptors(
-    std::vector<cv::KeyPoint> &kPtsSource, 
-    std::vector<cv::KeyPoint> &kPtsRef, 
-    cv::Mat &descSource, 
-    cv::Mat &descRef,
-    std::vector<cv::DMatch> &matches, 
-    std::string descriptorTypeCategory, 
-    std::string matcherType, 
-    std::string selectorType
-)
+static cv::Ptr<cv::DescriptorMatcher> createMatcher(const std::string &descriptorTypeCategory, const std::string &matcherType, const std::string &selectorType)
 {
     // configure matcher
-    bool crossCheck = true;
+    // Cross checking only supports a single neighbour, with KNN the ratio test filters the matches instead.
+    const bool crossCheck = selectorType.compare("SEL_NN") == 0;
     cv::Ptr<cv::DescriptorMatcher> matcher;
 
     // Brute-Force matching.
@@ -76,39 +64,186 @@ void matchDescriptors(
             throw std::runtime_error("Flann::Descriptor type not known!");
         }
     }
+    else
+    {
+        throw std::runtime_error("Matcher " + matcherType + " not known to this program.");
+    }
+
+    return matcher;
+}
+
+/**
+ * Descriptor distance ratio test to compare the two best matches of each query descriptor.
+ * 
+ * @param knn_matches <std::vector<std::vector<cv::DMatch>>> Two best matches of each query descriptor.
+ * @param matches <std::vector<cv::DMatch>> Selected matches.
+ */
+static void filterByDistanceRatio(const std::vector<std::vector<cv::DMatch>> &knn_matches, std::vector<cv::DMatch> &matches)
+{
+    const double dist_ratio_threshold = 0.8;
 
+    for (const auto &match : knn_matches)
+    {
+        // At least two matches needed for comparison.
+        if (match.size() < 2)
+        {
+            continue;
+        }
+
+        // Ratio test: keep the best match only if it is clearly better than the second best (d1/d2 < threshold).
+        if (match[0].distance < dist_ratio_threshold * match[1].distance)
+        {
+            // Add to matches.
+            matches.push_back(match[0]);
+        }
+    }
+}
+
+/**
+ * Match the query descriptors against the train descriptors and select the matches.
+ * 
+ * @param matcher <cv::DescriptorMatcher> Matcher.
+ * @param descQuery <cv::Mat> Query descriptors.
+ * @param descTrain <cv::Mat> Train descriptors.
+ * @param matches <std::vector<cv::DMatch>> Matches.
+ * @param selectorType <std::string> Type of the selector (SEL_NN or SEL_KNN).
+ */
+static void selectMatches(
+    const cv::DescriptorMatcher &matcher,
+    const cv::Mat &descQuery,
+    const cv::Mat &descTrain,
+    std::vector<cv::DMatch> &matches,
+    const std::string &selectorType
+)
+{
     // perform matching task
     if (selectorType.compare("SEL_NN") == 0)
     { 
         // nearest neighbor (best match)
-        matcher->match(descSource, descRef, matches); // Finds the best match for each descriptor in desc1
+        matcher.match(descQuery, descTrain, matches); // Finds the best match for each descriptor in desc1
     }
     else if (selectorType.compare("SEL_KNN") == 0)
     { 
         // k nearest neighbors (k=2)
         const int k = 2;
         std::vector<std::vector<cv::DMatch>> tmp_matches;
-        matcher->knnMatch(descSource, descRef, tmp_matches, k);
+        matcher.knnMatch(descQuery, descTrain, tmp_matches, k);
 
-        // Descriptor distance ratio test to compare the two best matches.
-        const double dist_ratio_threshold = 0.8;
+        filterByDistanceRatio(tmp_matches, matches);
+    }
+    else
+    {
+        throw std::runtime_error("Selector " + selectorType + " not known to this program.");
+    }
+}
 
-        for (auto match : tmp_matches)
+/**
+ * Find the match for keypoints in two camera images using the descriptors.
+ * 
+ * @param kPtsSource <std::vector<cv::KeyPoint>> Source keypoints.
+ * @param kPtsRef <std::vector<cv::KeyPoint>> Reference keypoints.
+ * @param descSource <cv::Mat> Descriptor source.
+ * @param descRef <cv::Mat> Descriptor reference.
+ * @param matches <std::vector<cv::DMatch>> Matches.
+ * @param descriptorTypeCategory <std::string> Category of the descriptor (either DES_HOG or DES_BINARY).
+ * @param matcherType <std::string> Type of the matcher (MAT_BF or MAT_FLANN).
+ * @param selectorType <std::string> Type of the selector (SEL_NN or SEL_KNN).
+ */
+void matchDescriptors(
+    std::vector<cv::KeyPoint> &kPtsSource, 
+    std::vector<cv::KeyPoint> &kPtsRef, 
+    cv::Mat &descSource, 
+    cv::Mat &descRef,
+    std::vector<cv::DMatch> &matches, 
+    std::string descriptorTypeCategory, 
+    std::string matcherType, 
+    std::string selectorType
+)
+{
+    const cv::Ptr<cv::DescriptorMatcher> matcher = createMatcher(descriptorTypeCategory, matcherType, selectorType);
+
+    selectMatches(*matcher, descSource, descRef, matches, selectorType);
+}
+
+/**
+ * Match the descriptors of several previous images against the descriptors of the current image at once.
+ * 
+ * The current descriptors are added to the matcher and trained once (for FLANN this builds the index a single time),
+ * then the descriptors of every previous image are queried against it in parallel. The roles are the same as in
+ * matchDescriptors for the previous and the current image: queryIdx indexes the target keypoints, trainIdx the current ones.
+ * 
+ * The threads share the matcher and call its non-const match/knnMatch. This relies on those calls only reading the
+ * matcher once it is trained (train() then returns early), which holds for BFMatcher and FlannBasedMatcher but is
+ * not a documented OpenCV guarantee.
+ * 
+ * @param descCurrent <cv::Mat> Descriptors of the current image.
+ * @param descTargets <std::vector<cv::Mat>> Descriptors of the previous images.
+ * @param matches <std::vector<std::vector<cv::DMatch>>> Matches for each target.
+ * @param descriptorTypeCategory <std::string> Category of the descriptor (either DES_HOG or DES_BINARY).
+ * @param matcherType <std::string> Type of the matcher (MAT_BF or MAT_FLANN).
+ * @param selectorType <std::string> Type of the selector (SEL_NN or SEL_KNN).
+ */
+void matchDescriptorsBatch(
+    const cv::Mat &descCurrent,
+    const std::vector<cv::Mat> &descTargets,
+    std::vector<std::vector<cv::DMatch>> &matches,
+    std::string descriptorTypeCategory,
+    std::string matcherType,
+    std::string selectorType
+)
+{
+    // Reject an unknown selector before the parallel loop, OpenCV 4.1 does not forward exceptions from its worker threads.
+    if (selectorType.compare("SEL_NN") != 0 && selectorType.compare("SEL_KNN") != 0)
+    {
+        throw std::runtime_error("Selector " + selectorType + " not known to this program.");
+    }
+
+    matches.resize(descTargets.size());
+    for (auto &target_matches : matches)
+    {
+        target_matches.clear();
+    }
+
+    // Nothing to match in an image without keypoints.
+    if (descCurrent.empty())
+    {
+        return;
+    }
+
+    const cv::Ptr<cv::DescriptorMatcher> matcher = createMatcher(descriptorTypeCategory, matcherType, selectorType);
+
+    // Train once, the parallel queries below then only read the trained data.
+    matcher->add(std::vector<cv::Mat>(1, descCurrent));
+    matcher->train();
+
+    const bool bKnn = selectorType.compare("SEL_KNN") == 0;
+
+    cv::parallel_for_(cv::Range(0, static_cast<int>(descTargets.size())), [&](const cv::Range &range) {
+        std::vector<std::vector<cv::DMatch>> knn_matches;
+
+        for (int i = range.start; i < range.end; ++i)
         {
-            // At least two matches needed for comparison.
-            if (match.size() < 2)
+            if (descTargets[i].empty())
             {
                 continue;
             }
 
-            // Ratio test: d1/d2 > threshold
-            if (match[1].distance != 0 && (match[0].distance / match[1].distance ) > dist_ratio_threshold)
+            if (bKnn)
+            {
+                // k nearest neighbors (k=2)
+                const int k = 2;
+                knn_matches.clear();
+                matcher->knnMatch(descTargets[i], knn_matches, k);
+
+                filterByDistanceRatio(knn_matches, matches[i]);
+            }
+            else
             {
-                // Add to matches.
-                matches.push_back(match[0]);
+                // nearest neighbor (best match)
+                matcher->match(descTargets[i], matches[i]);
             }
         }
-    }
+    });
 }
 
 // Use one of several types of state-of-art descriptors to uniquely identify keypoints
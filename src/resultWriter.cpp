@@ -0,0 +1,152 @@
+#include <cstdio>
+#include <stdexcept>
+#include "resultWriter.hpp"
+
+namespace
+{
+    /**
+     * Single named value of a result record.
+     */
+    struct Field
+    {
+        const char *name;
+        std::string value;
+        bool isString;
+    };
+
+    std::string formatNumber(double value)
+    {
+        char buffer[32];
+        std::snprintf(buffer, sizeof(buffer), "%.4f", value);
+        return buffer;
+    }
+
+    /**
+     * Flatten a result into its columns. The order defines the column order of the output.
+     */
+    void toFields(const FrameResult &result, std::vector<Field> &fields)
+    {
+        fields.clear();
+        fields.push_back({"image", std::to_string(result.image), false});
+        fields.push_back({"detector", result.detector, true});
+        fields.push_back({"descriptor", result.descriptor, true});
+        fields.push_back({"matcher", result.matcher, true});
+        fields.push_back({"selector", result.selector, true});
+        fields.push_back({"pts_total", std::to_string(result.ptsTotal), false});
+        fields.push_back({"pts_vehicle", std::to_string(result.ptsVehicle), false});
+        fields.push_back({"matches_raw", std::to_string(result.matchesRaw), false});
+        fields.push_back({"matches", std::to_string(result.matches), false});
+        fields.push_back({"matches_raw_all", std::to_string(result.matchesRawAll), false});
+        fields.push_back({"matches_all", std::to_string(result.matchesAll), false});
+        fields.push_back({"time_detector_ms", formatNumber(result.timeDetector), false});
+        fields.push_back({"time_descriptor_ms", formatNumber(result.timeDescriptor), false});
+        fields.push_back({"time_matcher_ms", formatNumber(result.timeMatcher), false});
+        fields.push_back({"time_verification_ms", formatNumber(result.timeVerification), false});
+        fields.push_back({"frame_bytes", std::to_string(result.frameBytes), false});
+        fields.push_back({"buffer_bytes", std::to_string(result.bufferBytes), false});
+        fields.push_back({"matching_cache_lines_modeled", std::to_string(result.matchingCacheLinesModeled), false});
+        fields.push_back({"targets", std::to_string(result.targets), false});
+        fields.push_back({"tracks_continued", std::to_string(result.tracksContinued), false});
+        fields.push_back({"tracks_recovered", std::to_string(result.tracksRecovered), false});
+        fields.push_back({"track_length_mean", formatNumber(result.trackLengthMean), false});
+        fields.push_back({"track_length_max", std::to_string(result.trackLengthMax), false});
+    }
+
+    void appendJsonString(std::string &out, const std::string &value)
+    {
+        out += '"';
+        for (const char c : value)
+        {
+            if (c == '"' || c == '\\')
+            {
+                out += '\\';
+            }
+            out += c;
+        }
+        out += '"';
+    }
+}
+
+ResultWriter::ResultWriter(const std::string &format) : format_(format)
+{
+    if (format_ != "OUT_CSV" && format_ != "OUT_JSONL")
+    {
+        throw std::runtime_error("Output format " + format_ + " not known to this program.");
+    }
+}
+
+void ResultWriter::add(const FrameResult &result)
+{
+    results_.push_back(result);
+}
+
+void ResultWriter::write(std::ostream &os) const
+{
+    std::string out;
+
+    if (format_ == "OUT_CSV")
+    {
+        formatCsv(out);
+    }
+    else
+    {
+        formatJsonLines(out);
+    }
+
+    os.write(out.data(), out.size());
+    os.flush();
+}
+
+void ResultWriter::formatCsv(std::string &out) const
+{
+    std::vector<Field> fields;
+
+    // Header.
+    toFields(FrameResult(), fields);
+    for (size_t i = 0; i < fields.size(); ++i)
+    {
+        out += (i == 0 ? "" : ",");
+        out += fields[i].name;
+    }
+    out += '\n';
+
+    // One row per frame. Types and descriptors never contain commas, so no quoting is needed.
+    for (const auto &result : results_)
+    {
+        toFields(result, fields);
+        for (size_t i = 0; i < fields.size(); ++i)
+        {
+            out += (i == 0 ? "" : ",");
+            out += fields[i].value;
+        }
+        out += '\n';
+    }
+}
+
+void ResultWriter::formatJsonLines(std::string &out) const
+{
+    std::vector<Field> fields;
+
+    // One JSON object per frame.
+    for (const auto &result : results_)
+    {
+        toFields(result, fields);
+        out += '{';
+        for (size_t i = 0; i < fields.size(); ++i)
+        {
+            out += (i == 0 ? "\"" : ",\"");
+            out += fields[i].name;
+            out += "\":";
+
+            if (fields[i].isString)
+            {
+                appendJsonString(out, fields[i].value);
+            }
+            else
+            {
+                out += fields[i].value;
+            }
+        }
+        out += "}\n";
+    }
+}
@@ -0,0 +1,45 @@
+#ifndef resultWriter_hpp
+#define resultWriter_hpp
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "dataStructures.h"
+
+
+/**
+ * Collects the per-frame results in memory and writes them out in bulk once the run is finished,
+ * so the main loop does not pay for formatting and flushing the output stream on every frame.
+ */
+class ResultWriter
+{
+public:
+    /**
+     * @param format <std::string> Output format (OUT_CSV or OUT_JSONL).
+     */
+    explicit ResultWriter(const std::string &format);
+
+    /**
+     * Buffer the results of a single frame.
+     *
+     * @param result <FrameResult> Results of the frame.
+     */
+    void add(const FrameResult &result);
+
+    /**
+     * Format all buffered results and write them to the stream with a single write.
+     *
+     * @param os <std::ostream> Output stream.
+     */
+    void write(std::ostream &os) const;
+
+private:
+    void formatCsv(std::string &out) const;
+    void formatJsonLines(std::string &out) const;
+
+    std::string format_;
+    std::vector<FrameResult> results_;
+};
+
+#endif /* resultWriter_hpp */
@@ -0,0 +1,647 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+
+#include "verification2D.hpp"
+
+namespace
+{
+    /**
+     * Product of two 3x3 matrices in row major order, c = a * b.
+     */
+    void multiply33(const double *a, const double *b, double *c)
+    {
+        for (int i = 0; i < 3; ++i)
+        {
+            for (int j = 0; j < 3; ++j)
+            {
+                c[3 * i + j] = a[3 * i] * b[j] + a[3 * i + 1] * b[3 + j] + a[3 * i + 2] * b[6 + j];
+            }
+        }
+    }
+
+    double determinant33(const double *a)
+    {
+        return a[0] * (a[4] * a[8] - a[5] * a[7]) - a[1] * (a[3] * a[8] - a[5] * a[6]) + a[2] * (a[3] * a[7] - a[4] * a[6]);
+    }
+
+    /**
+     * Hartley normalization: move the centroid of the points to the origin and scale their mean distance to sqrt(2).
+     *
+     * @param pts <std::vector<cv::Point2f>> Points.
+     * @param normalized <double[][2]> Normalized points.
+     * @param T <double[9]> Normalizing transformation.
+     * @param T_inv <double[9]> Its inverse.
+     */
+    void normalizePoints(const std::vector<cv::Point2f> &pts, double (*normalized)[2], double *T, double *T_inv)
+    {
+        const int n = static_cast<int>(pts.size());
+
+        double cx = 0.0;
+        double cy = 0.0;
+        for (int i = 0; i < n; ++i)
+        {
+            cx += pts[i].x;
+            cy += pts[i].y;
+        }
+        cx /= n;
+        cy /= n;
+
+        double mean_dist = 0.0;
+        for (int i = 0; i < n; ++i)
+        {
+            mean_dist += std::hypot(pts[i].x - cx, pts[i].y - cy);
+        }
+        mean_dist /= n;
+
+        const double scale = mean_dist > 0.0 ? std::sqrt(2.0) / mean_dist : 1.0;
+
+        for (int i = 0; i < n; ++i)
+        {
+            normalized[i][0] = scale * (pts[i].x - cx);
+            normalized[i][1] = scale * (pts[i].y - cy);
+        }
+
+        const double t[9] = {scale, 0.0, -scale * cx, 0.0, scale, -scale * cy, 0.0, 0.0, 1.0};
+        const double t_inv[9] = {1.0 / scale, 0.0, cx, 0.0, 1.0 / scale, cy, 0.0, 0.0, 1.0};
+        std::copy(t, t + 9, T);
+        std::copy(t_inv, t_inv + 9, T_inv);
+    }
+
+    /**
+     * Null space of a homogeneous Rows x 9 system of full row rank, by Gauss-Jordan elimination with full pivoting.
+     *
+     * @param A <double[Rows][9]> System, overwritten.
+     * @param basis <double[9 - Rows][9]> Basis vectors of the null space.
+     * @return <bool> False if the system is rank deficient (degenerate sample).
+     */
+    template <int Rows>
+    bool nullSpace(double (&A)[Rows][9], double (&basis)[9 - Rows][9])
+    {
+        int cols[9];
+        std::iota(cols, cols + 9, 0);
+
+        for (int r = 0; r < Rows; ++r)
+        {
+            int pivot_row = r;
+            int pivot_col = r;
+            double pivot = 0.0;
+
+            for (int i = r; i < Rows; ++i)
+            {
+                for (int j = r; j < 9; ++j)
+                {
+                    if (std::abs(A[i][j]) > pivot)
+                    {
+                        pivot = std::abs(A[i][j]);
+                        pivot_row = i;
+                        pivot_col = j;
+                    }
+                }
+            }
+
+            if (pivot < 1e-10)
+            {
+                return false;
+            }
+
+            for (int j = 0; j < 9; ++j)
+            {
+                std::swap(A[r][j], A[pivot_row][j]);
+            }
+            for (int i = 0; i < Rows; ++i)
+            {
+                std::swap(A[i][r], A[i][pivot_col]);
+            }
+            std::swap(cols[r], cols[pivot_col]);
+
+            const double inv_pivot = 1.0 / A[r][r];
+            for (int j = 0; j < 9; ++j)
+            {
+                A[r][j] *= inv_pivot;
+            }
+
+            for (int i = 0; i < Rows; ++i)
+            {
+                const double factor = A[i][r];
+                if (i == r || factor == 0.0)
+                {
+                    continue;
+                }
+
+                for (int j = 0; j < 9; ++j)
+                {
+                    A[i][j] -= factor * A[r][j];
+                }
+            }
+        }
+
+        // A = [I | B], every free column gives one basis vector.
+        for (int k = 0; k < 9 - Rows; ++k)
+        {
+            std::fill(basis[k], basis[k] + 9, 0.0);
+            basis[k][cols[Rows + k]] = 1.0;
+
+            for (int i = 0; i < Rows; ++i)
+            {
+                basis[k][cols[i]] = -A[i][Rows + k];
+            }
+        }
+
+        return true;
+    }
+
+    /**
+     * Real roots of c0 * x^3 + c1 * x^2 + c2 * x + c3 = 0.
+     *
+     * @param roots <double[3]> Roots.
+     * @return <int> Number of roots.
+     */
+    int solveCubic(double c0, double c1, double c2, double c3, double *roots)
+    {
+        const double eps = 1e-12 * std::max(std::max(std::abs(c0), std::abs(c1)), std::max(std::abs(c2), std::abs(c3)));
+
+        if (std::abs(c0) <= eps)
+        {
+            // Quadratic or linear.
+            if (std::abs(c1) <= eps)
+            {
+                if (std::abs(c2) <= eps)
+                {
+                    return 0;
+                }
+
+                roots[0] = -c3 / c2;
+                return 1;
+            }
+
+            const double disc = c2 * c2 - 4.0 * c1 * c3;
+            if (disc < 0.0)
+            {
+                return 0;
+            }
+
+            roots[0] = (-c2 + std::sqrt(disc)) / (2.0 * c1);
+            roots[1] = (-c2 - std::sqrt(disc)) / (2.0 * c1);
+            return 2;
+        }
+
+        const double a = c1 / c0;
+        const double b = c2 / c0;
+        const double d = c3 / c0;
+        const double Q = (a * a - 3.0 * b) / 9.0;
+        const double R = (2.0 * a * a * a - 9.0 * a * b + 27.0 * d) / 54.0;
+
+        if (R * R < Q * Q * Q)
+        {
+            // Three real roots.
+            const double theta = std::acos(R / std::sqrt(Q * Q * Q));
+            const double factor = -2.0 * std::sqrt(Q);
+
+            roots[0] = factor * std::cos(theta / 3.0) - a / 3.0;
+            roots[1] = factor * std::cos((theta + 2.0 * CV_PI) / 3.0) - a / 3.0;
+            roots[2] = factor * std::cos((theta - 2.0 * CV_PI) / 3.0) - a / 3.0;
+            return 3;
+        }
+
+        const double A = -std::copysign(std::cbrt(std::abs(R) + std::sqrt(R * R - Q * Q * Q)), R);
+        const double B = A != 0.0 ? Q / A : 0.0;
+
+        roots[0] = A + B - a / 3.0;
+        return 1;
+    }
+}
+
+GeometricVerifier::GeometricVerifier(const std::string &verifierType, double threshold, double confidence, int maxIterations)
+    : verifierType_(verifierType),
+      sampleSize_(0),
+      threshold2_(static_cast<float>(threshold * threshold)),
+      confidence_(confidence),
+      maxIterations_(maxIterations),
+      rng_(0x12345678)
+{
+    if (verifierType_ == "VER_HOMOGRAPHY")
+    {
+        // Four point correspondences define a homography.
+        sampleSize_ = 4;
+    }
+    else if (verifierType_ == "VER_FUNDAMENTAL")
+    {
+        // Seven point algorithm.
+        sampleSize_ = 7;
+    }
+    else if (verifierType_ != "VER_NONE")
+    {
+        throw std::runtime_error("Verifier " + verifierType_ + " not known to this program.");
+    }
+
+    sample_.resize(sampleSize_);
+    samplePtsSrc_.resize(sampleSize_);
+    samplePtsRef_.resize(sampleSize_);
+
+    // The seven point algorithm returns up to three solutions.
+    models_.reserve(3 * 9);
+}
+
+void GeometricVerifier::verify(const std::vector<cv::KeyPoint> &kPtsSource, const std::vector<cv::KeyPoint> &kPtsRef, std::vector<cv::DMatch> &matches)
+{
+    if (sampleSize_ == 0)
+    {
+        return;
+    }
+
+    const int n_matches = static_cast<int>(matches.size());
+    resizeBuffers(n_matches);
+
+    // Gather the matched points.
+    for (int i = 0; i < n_matches; ++i)
+    {
+        const cv::Point2f &src = kPtsSource[matches[i].queryIdx].pt;
+        const cv::Point2f &ref = kPtsRef[matches[i].trainIdx].pt;
+
+        srcX_[i] = src.x;
+        srcY_[i] = src.y;
+        refX_[i] = ref.x;
+        refY_[i] = ref.y;
+    }
+
+    estimate(matches);
+}
+
+void GeometricVerifier::verify(const KeyPointsSoA &kPtsSource, const KeyPointsSoA &kPtsRef, std::vector<cv::DMatch> &matches)
+{
+    if (sampleSize_ == 0)
+    {
+        return;
+    }
+
+    const int n_matches = static_cast<int>(matches.size());
+    resizeBuffers(n_matches);
+
+    // Gather the matched points, only the coordinates are read.
+    for (int i = 0; i < n_matches; ++i)
+    {
+        srcX_[i] = kPtsSource.x[matches[i].queryIdx];
+        srcY_[i] = kPtsSource.y[matches[i].queryIdx];
+        refX_[i] = kPtsRef.x[matches[i].trainIdx];
+        refY_[i] = kPtsRef.y[matches[i].trainIdx];
+    }
+
+    estimate(matches);
+}
+
+/**
+ * Resize the working buffers to the number of matches. They only grow, so after the first frames no allocation takes place.
+ *
+ * @param n <int> Number of matches.
+ */
+void GeometricVerifier::resizeBuffers(int n)
+{
+    srcX_.resize(n);
+    srcY_.resize(n);
+    refX_.resize(n);
+    refY_.resize(n);
+    residuals_.resize(n);
+    order_.resize(n);
+}
+
+/**
+ * Run PROSAC on the gathered points and keep only the inliers of the best model.
+ *
+ * @param matches <std::vector<cv::DMatch>> Matches, in the same order as the gathered points.
+ */
+void GeometricVerifier::estimate(std::vector<cv::DMatch> &matches)
+{
+    const int n_matches = static_cast<int>(matches.size());
+    const int m = sampleSize_;
+
+    // Not enough matches to fit a model, none of them can be verified.
+    if (n_matches < m)
+    {
+        matches.clear();
+        return;
+    }
+
+    // PROSAC draws from the matches with the lowest descriptor distance first.
+    std::iota(order_.begin(), order_.end(), 0);
+    std::stable_sort(order_.begin(), order_.end(), [&matches](int a, int b) {
+        return matches[a].distance < matches[b].distance;
+    });
+
+    // PROSAC growth function: t_n is the average number of samples drawn from the n best matches
+    // (T_n in the paper), t_n_prime the iteration at which the pool grows to n + 1 matches.
+    double t_n = maxIterations_;
+    for (int i = 0; i < m; ++i)
+    {
+        t_n *= static_cast<double>(m - i) / static_cast<double>(n_matches - i);
+    }
+
+    int n = m;
+    int t_n_prime = 1;
+    int max_iterations = maxIterations_;
+    int best_inliers = 0;
+    double best_model[9];
+
+    for (int t = 1; t <= max_iterations; ++t)
+    {
+        if (t == t_n_prime && n < n_matches)
+        {
+            const double t_n_next = t_n * (n + 1) / (n + 1 - m);
+            t_n_prime += static_cast<int>(std::ceil(t_n_next - t_n));
+            t_n = t_n_next;
+            ++n;
+        }
+
+        // Until the schedule has caught up, every sample contains the n-th best match.
+        drawSample(n, t_n_prime >= t);
+        fitModels();
+
+        for (size_t k = 0; k + 9 <= models_.size(); k += 9)
+        {
+            const int inliers = scoreModel(&models_[k]);
+
+            if (inliers > best_inliers)
+            {
+                best_inliers = inliers;
+                std::copy(models_.begin() + k, models_.begin() + k + 9, best_model);
+
+                // Adaptive termination: number of samples needed to draw an all-inlier sample with the desired confidence.
+                const double p_good_sample = std::pow(static_cast<double>(best_inliers) / n_matches, m);
+
+                if (p_good_sample >= 1.0)
+                {
+                    max_iterations = t;
+                }
+                else
+                {
+                    // For tiny probabilities no bound below maxIterations_ follows, and the division would blow up.
+                    const double log_p_bad_sample = std::log1p(-p_good_sample);
+
+                    if (log_p_bad_sample < -std::numeric_limits<double>::epsilon())
+                    {
+                        // Clamp before casting, the number of samples needed can exceed the range of int.
+                        const double k_needed = std::ceil(std::log(1.0 - confidence_) / log_p_bad_sample);
+                        max_iterations = static_cast<int>(std::min<double>(max_iterations, k_needed));
+                    }
+                }
+            }
+        }
+    }
+
+    if (best_inliers == 0)
+    {
+        matches.clear();
+        return;
+    }
+
+    // Keep only the inliers of the best model, in their original order.
+    scoreModel(best_model);
+
+    size_t kept = 0;
+    for (int i = 0; i < n_matches; ++i)
+    {
+        if (residuals_[i] <= threshold2_)
+        {
+            matches[kept++] = matches[i];
+        }
+    }
+    matches.resize(kept);
+}
+
+/**
+ * Draw a minimal sample from the n best matches.
+ *
+ * @param n <int> Size of the pool of best matches to sample from.
+ * @param includeLast <bool> Whether the n-th best match is always part of the sample.
+ */
+void GeometricVerifier::drawSample(int n, bool includeLast)
+{
+    const int m = sampleSize_;
+    const int pool = includeLast ? n - 1 : n;
+    const int drawn = includeLast ? m - 1 : m;
+
+    for (int i = 0; i < drawn; ++i)
+    {
+        int idx;
+        do
+        {
+            idx = rng_.uniform(0, pool);
+        } while (std::find(sample_.begin(), sample_.begin() + i, idx) != sample_.begin() + i);
+
+        sample_[i] = idx;
+    }
+
+    if (includeLast)
+    {
+        sample_[m - 1] = n - 1;
+    }
+
+    // Map ranks to match indices.
+    for (int i = 0; i < m; ++i)
+    {
+        sample_[i] = order_[sample_[i]];
+    }
+}
+
+/**
+ * Fit the model(s) to the current minimal sample. Degenerate samples yield no model.
+ *
+ * The minimal solvers work on fixed-size arrays on the stack, so no memory is allocated per iteration.
+ */
+void GeometricVerifier::fitModels()
+{
+    models_.clear();
+
+    for (int i = 0; i < sampleSize_; ++i)
+    {
+        samplePtsSrc_[i] = cv::Point2f(srcX_[sample_[i]], srcY_[sample_[i]]);
+        samplePtsRef_[i] = cv::Point2f(refX_[sample_[i]], refY_[sample_[i]]);
+    }
+
+    // Solve in normalized coordinates for numerical stability.
+    double src[7][2];
+    double ref[7][2];
+    double T_src[9], T_src_inv[9];
+    double T_ref[9], T_ref_inv[9];
+    normalizePoints(samplePtsSrc_, src, T_src, T_src_inv);
+    normalizePoints(samplePtsRef_, ref, T_ref, T_ref_inv);
+
+    double tmp[9];
+    double model[9];
+
+    if (sampleSize_ == 4)
+    {
+        // DLT: two equations per correspondence for the nine entries of H.
+        double A[8][9];
+        for (int i = 0; i < 4; ++i)
+        {
+            const double x = src[i][0], y = src[i][1];
+            const double u = ref[i][0], v = ref[i][1];
+
+            const double row_u[9] = {x, y, 1.0, 0.0, 0.0, 0.0, -u * x, -u * y, -u};
+            const double row_v[9] = {0.0, 0.0, 0.0, x, y, 1.0, -v * x, -v * y, -v};
+            std::copy(row_u, row_u + 9, A[2 * i]);
+            std::copy(row_v, row_v + 9, A[2 * i + 1]);
+        }
+
+        double h[1][9];
+        if (!nullSpace(A, h))
+        {
+            return;
+        }
+
+        // Undo the normalization: H = T_ref^-1 * H_n * T_src.
+        multiply33(T_ref_inv, h[0], tmp);
+        multiply33(tmp, T_src, model);
+
+        if (std::abs(model[8]) < 1e-12)
+        {
+            return;
+        }
+
+        const double inv_h22 = 1.0 / model[8];
+        for (int k = 0; k < 9; ++k)
+        {
+            model[k] *= inv_h22;
+        }
+
+        const double det = determinant33(model);
+        if (std::isfinite(det) && std::abs(det) > 1e-8)
+        {
+            models_.insert(models_.end(), model, model + 9);
+        }
+    }
+    else
+    {
+        // Seven point algorithm: the epipolar constraint ref^T * F * src = 0 leaves a two-dimensional null space.
+        double A[7][9];
+        for (int i = 0; i < 7; ++i)
+        {
+            const double x = src[i][0], y = src[i][1];
+            const double u = ref[i][0], v = ref[i][1];
+
+            const double row[9] = {u * x, u * y, u, v * x, v * y, v, x, y, 1.0};
+            std::copy(row, row + 9, A[i]);
+        }
+
+        double f[2][9];
+        if (!nullSpace(A, f))
+        {
+            return;
+        }
+
+        // F = l * D + F2 with D = F1 - F2. det(F) = 0 is a cubic in l, whose coefficients follow from
+        // det(D), det(F2) and the determinants at l = 1 and l = -1.
+        double D[9], F_minus[9];
+        for (int k = 0; k < 9; ++k)
+        {
+            D[k] = f[0][k] - f[1][k];
+            F_minus[k] = f[1][k] - D[k];
+        }
+
+        const double c0 = determinant33(D);
+        const double c3 = determinant33(f[1]);
+        const double p_plus = determinant33(f[0]);
+        const double p_minus = determinant33(F_minus);
+        const double c1 = 0.5 * (p_plus + p_minus) - c3;
+        const double c2 = 0.5 * (p_plus - p_minus) - c0;
+
+        double roots[3];
+        const int n_roots = solveCubic(c0, c1, c2, c3, roots);
+
+        for (int r = 0; r < n_roots; ++r)
+        {
+            double F_n[9];
+            for (int k = 0; k < 9; ++k)
+            {
+                F_n[k] = roots[r] * D[k] + f[1][k];
+            }
+
+            // Undo the normalization: F = T_ref^T * F_n * T_src.
+            const double T_ref_t[9] = {T_ref[0], T_ref[3], T_ref[6], T_ref[1], T_ref[4], T_ref[7], T_ref[2], T_ref[5], T_ref[8]};
+            multiply33(T_ref_t, F_n, tmp);
+            multiply33(tmp, T_src, model);
+
+            // The scale of F is arbitrary, bring it to unit norm.
+            double norm = 0.0;
+            for (int k = 0; k < 9; ++k)
+            {
+                norm += model[k] * model[k];
+            }
+            norm = std::sqrt(norm);
+
+            if (!std::isfinite(norm) || norm == 0.0)
+            {
+                continue;
+            }
+
+            for (int k = 0; k < 9; ++k)
+            {
+                model[k] /= norm;
+            }
+            models_.insert(models_.end(), model, model + 9);
+        }
+    }
+}
+
+/**
+ * Compute the residuals of all matches for a model and count the inliers.
+ *
+ * The loops run over plain float arrays without branches, so the compiler vectorizes them
+ * with the SIMD instruction set of the target.
+ *
+ * @param model <double*> 3x3 model in row major order.
+ * @return <int> Number of inliers.
+ */
+int GeometricVerifier::scoreModel(const double *model)
+{
+    const int n = static_cast<int>(srcX_.size());
+
+    const float m0 = static_cast<float>(model[0]), m1 = static_cast<float>(model[1]), m2 = static_cast<float>(model[2]);
+    const float m3 = static_cast<float>(model[3]), m4 = static_cast<float>(model[4]), m5 = static_cast<float>(model[5]);
+    const float m6 = static_cast<float>(model[6]), m7 = static_cast<float>(model[7]), m8 = static_cast<float>(model[8]);
+
+    const float *const sx = srcX_.data();
+    const float *const sy = srcY_.data();
+    const float *const rx = refX_.data();
+    const float *const ry = refY_.data();
+    float *const residuals = residuals_.data();
+
+    if (sampleSize_ == 4)
+    {
+        // Squared transfer error of the source point mapped by the homography.
+        for (int i = 0; i < n; ++i)
+        {
+            const float inv_w = 1.0f / (m6 * sx[i] + m7 * sy[i] + m8);
+            const float dx = (m0 * sx[i] + m1 * sy[i] + m2) * inv_w - rx[i];
+            const float dy = (m3 * sx[i] + m4 * sy[i] + m5) * inv_w - ry[i];
+
+            residuals[i] = dx * dx + dy * dy;
+        }
+    }
+    else
+    {
+        // Sampson distance of the reference point to the epipolar line of the source point.
+        for (int i = 0; i < n; ++i)
+        {
+            const float a = m0 * sx[i] + m1 * sy[i] + m2;
+            const float b = m3 * sx[i] + m4 * sy[i] + m5;
+            const float c = m6 * sx[i] + m7 * sy[i] + m8;
+            const float d = m0 * rx[i] + m3 * ry[i] + m6;
+            const float e = m1 * rx[i] + m4 * ry[i] + m7;
+            const float err = rx[i] * a + ry[i] * b + c;
+
+            residuals[i] = err * err / (a * a + b * b + d * d + e * e);
+        }
+    }
+
+    int inliers = 0;
+    for (int i = 0; i < n; ++i)
+    {
+        inliers += residuals[i] <= threshold2_ ? 1 : 0;
+    }
+
+    return inliers;
+}
@@ -0,0 +1,79 @@
+#ifndef verification2D_hpp
+#define verification2D_hpp
+
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "dataStructures.h"
+
+
+/**
+ * Geometric verification of keypoint matches between two camera images.
+ *
+ * A homography or a fundamental matrix is fitted to the matches with PROSAC (RANSAC which draws its samples
+ * progressively from the matches with the smallest descriptor distance) using adaptive termination.
+ * All working memory is held by the verifier and reused between frames.
+ */
+class GeometricVerifier
+{
+public:
+    /**
+     * @param verifierType <std::string> Type of the verification (VER_NONE, VER_HOMOGRAPHY or VER_FUNDAMENTAL).
+     * @param threshold <double> Maximum residual of an inlier [px].
+     * @param confidence <double> Desired probability of drawing at least one all-inlier sample.
+     * @param maxIterations <int> Upper bound on the number of drawn samples.
+     */
+    explicit GeometricVerifier(const std::string &verifierType, double threshold = 3.0, double confidence = 0.99, int maxIterations = 2000);
+
+    /**
+     * Remove all matches which are not consistent with the best model found.
+     *
+     * @param kPtsSource <std::vector<cv::KeyPoint>> Source keypoints (indexed by queryIdx).
+     * @param kPtsRef <std::vector<cv::KeyPoint>> Reference keypoints (indexed by trainIdx).
+     * @param matches <std::vector<cv::DMatch>> Matches, only the inliers are kept.
+     */
+    void verify(const std::vector<cv::KeyPoint> &kPtsSource, const std::vector<cv::KeyPoint> &kPtsRef, std::vector<cv::DMatch> &matches);
+
+    /**
+     * Same as above for keypoint positions stored in structure-of-arrays layout (lean storage mode).
+     *
+     * @param kPtsSource <KeyPointsSoA> Source keypoint positions (indexed by queryIdx).
+     * @param kPtsRef <KeyPointsSoA> Reference keypoint positions (indexed by trainIdx).
+     * @param matches <std::vector<cv::DMatch>> Matches, only the inliers are kept.
+     */
+    void verify(const KeyPointsSoA &kPtsSource, const KeyPointsSoA &kPtsRef, std::vector<cv::DMatch> &matches);
+
+private:
+    void resizeBuffers(int n);
+    void estimate(std::vector<cv::DMatch> &matches);
+    void drawSample(int n, bool includeLast);
+    void fitModels();
+    int scoreModel(const double *model);
+
+    std::string verifierType_;
+    int sampleSize_;
+    float threshold2_;
+    double confidence_;
+    int maxIterations_;
+    cv::RNG rng_;
+
+    // Correspondences in structure-of-arrays layout, in the original order of the matches.
+    std::vector<float> srcX_;
+    std::vector<float> srcY_;
+    std::vector<float> refX_;
+    std::vector<float> refY_;
+    std::vector<float> residuals_;
+
+    // Indices of the matches sorted by ascending descriptor distance.
+    std::vector<int> order_;
+
+    // Current minimal sample and the models fitted to it (3x3 each, row major).
+    std::vector<int> sample_;
+    std::vector<cv::Point2f> samplePtsSrc_;
+    std::vector<cv::Point2f> samplePtsRef_;
+    std::vector<double> models_;
+};
+
+#endif /* verification2D_hpp */